@@ -0,0 +1,114 @@
+/*
+ * Dream Cheeky USB Thunder Launcher - definitions shared between the
+ * kernel module and the user space tools
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, version 2.
+ */
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Trace record types */
+#define LAUNCHER_TRACE_COMMAND          0x01    /* Command byte passed to write() */
+#define LAUNCHER_TRACE_CORRECTION       0x02    /* Command issued by the driver itself */
+#define LAUNCHER_TRACE_STATUS           0x03    /* Interrupt-in status report, when it changes */
+#define LAUNCHER_TRACE_OVERFLOW         0x04    /* data holds a __u32 count of lost records */
+
+#define LAUNCHER_TRACE_DATA_SIZE        8
+
+/*
+ * Trace file layout: one header followed by the records as read() returned
+ * them. The debugfs trace file produces exactly this stream.
+ */
+#define LAUNCHER_TRACE_MAGIC            0x54434c44      /* "DLCT" */
+#define LAUNCHER_TRACE_VERSION          1
+
+struct launcher_trace_header {
+        __u32   magic;
+        __u16   version;
+        __u16   record_size;            /* sizeof(struct launcher_trace_record) */
+};
+
+/*
+ * One record of the trace returned by read() on the device node.
+ * Timestamps are CLOCK_MONOTONIC nanoseconds so they can be compared
+ * with clock_gettime() in user space.
+ */
+struct launcher_trace_record {
+        __u64   timestamp_ns;
+        __u8    type;
+        __u8    length;                 /* Valid bytes in data */
+        __u8    reserved[6];
+        __u8    data[LAUNCHER_TRACE_DATA_SIZE];
+};
+
+/*
+ * Keep-out zones. Positions are milliseconds of travel, dead-reckoned by
+ * the driver from the left and bottom limit switches, so zones are only
+ * enforced once the turret has touched both (see launcher_state.homed).
+ * The driver looks one interrupt interval ahead and stops motion before
+ * it enters a LAUNCHER_ZONE_NO_MOVE zone; from inside one only motion
+ * towards the nearest edge is allowed. Until homed, FIRE is refused
+ * whenever a LAUNCHER_ZONE_NO_FIRE zone is set. The limit switches are
+ * polled from plug-in to unplug, so homing survives close; closing the
+ * device only stops any motion.
+ */
+#define LAUNCHER_MAX_ZONES              8
+
+#define LAUNCHER_ZONE_NO_MOVE           0x01
+#define LAUNCHER_ZONE_NO_FIRE           0x02    /* write() of LAUNCHER_FIRE fails with EPERM */
+
+struct launcher_zone {
+        __u32   index;                  /* 0 .. LAUNCHER_MAX_ZONES - 1 */
+        __u32   flags;                  /* 0 disables the slot */
+        __s32   pan_min;
+        __s32   pan_max;
+        __s32   tilt_min;
+        __s32   tilt_max;
+};
+
+#define LAUNCHER_HOMED_PAN              0x01
+#define LAUNCHER_HOMED_TILT             0x02
+
+/*
+ * Rejection latency runs from write() entry to the refusal. Clamp latency
+ * runs from write() entry, or from the status report that triggered the
+ * clamp, until the control transfer carrying the stop has completed.
+ */
+struct launcher_state {
+        __s32   pan;                    /* ms right of the left limit */
+        __s32   tilt;                   /* ms above the bottom limit */
+        __u32   homed;
+        __u32   rejections;             /* Refused LAUNCHER_FIRE commands */
+        __u32   clamps;                 /* Motions stopped at a zone edge */
+        __u32   last_reject_ns;
+        __u32   max_reject_ns;
+        __u32   last_clamp_ns;
+        __u32   max_clamp_ns;
+};
+
+#define LAUNCHER_IOC_MAGIC              'L'
+#define LAUNCHER_IOC_SET_ZONE           _IOW(LAUNCHER_IOC_MAGIC, 1, struct launcher_zone)
+#define LAUNCHER_IOC_CLEAR_ZONES        _IO(LAUNCHER_IOC_MAGIC, 2)
+#define LAUNCHER_IOC_GET_STATE          _IOR(LAUNCHER_IOC_MAGIC, 3, struct launcher_state)
+#define LAUNCHER_IOC_GET_XFER_STATS     _IOR(LAUNCHER_IOC_MAGIC, 4, struct launcher_xfer_stats)
+
+/*
+ * Transfer accounting. write() and the interrupt handler allocate nothing
+ * themselves - every buffer and URB is set up at probe - which is a
+ * property of the code rather than something counted here. Mappings and
+ * bounces happen in the host controller driver, out of this driver's
+ * sight; see the README for how to observe them.
+ */
+struct launcher_xfer_stats {
+        __u32   writes;                 /* Commands sent from write() or close */
+        __u32   corrections;            /* Commands sent from the interrupt handler */
+        __u32   status_reports;
+};
+
+#endif /* LAUNCHER_H */
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "launcher.h"
 
 #define LAUNCHER_NODE           "/dev/launcher0"
 #define LAUNCHER_FIRE           0x10
@@ -23,15 +26,98 @@ static void launcher_cmd(int fd, int cmd)
         if (retval < 0) {
                 fprintf(stderr, "Could not send command to " LAUNCHER_NODE
                         " (error %d)\n", retval);
-        } else if (LAUNCHER_FIRE == cmd) {
-                usleep(5000000);
-                exit(0);
         }
 }
 
+static void launcher_set_zone(int fd, const char *spec)
+{
+        struct launcher_zone zone;
+
+        if (sscanf(spec, "%u,%d,%d,%d,%d,%u", &zone.index, &zone.pan_min, &zone.pan_max,
+                   &zone.tilt_min, &zone.tilt_max, &zone.flags) != 6) {
+                fprintf(stderr, "Bad zone '%s'\n", spec);
+                exit(1);
+        }
+
+        if (ioctl(fd, LAUNCHER_IOC_SET_ZONE, &zone) < 0) {
+                perror("Could not set zone");
+                exit(1);
+        }
+}
+
+static void launcher_print_state(int fd)
+{
+        struct launcher_state state;
+        struct launcher_xfer_stats xfer;
+
+        if (ioctl(fd, LAUNCHER_IOC_GET_STATE, &state) < 0) {
+                perror("Could not read state");
+                return;
+        }
+
+        printf("Position: pan %d ms%s, tilt %d ms%s\n",
+               state.pan, state.homed & LAUNCHER_HOMED_PAN ? "" : " (not homed)",
+               state.tilt, state.homed & LAUNCHER_HOMED_TILT ? "" : " (not homed)");
+        printf("Fire rejections: %u (last %u ns, max %u ns)\n",
+               state.rejections, state.last_reject_ns, state.max_reject_ns);
+        printf("Zone clamps: %u (last %u ns, max %u ns)\n",
+               state.clamps, state.last_clamp_ns, state.max_clamp_ns);
+
+        if (ioctl(fd, LAUNCHER_IOC_GET_XFER_STATS, &xfer) < 0) {
+                perror("Could not read transfer statistics");
+                return;
+        }
+
+        printf("Transfers: %u writes, %u corrections, %u status reports\n",
+               xfer.writes, xfer.corrections, xfer.status_reports);
+}
+
+/* The driver's trace ring outlives each open, drop what came before us */
+static void launcher_discard_trace(int fd)
+{
+        struct launcher_trace_record rec[64];
+
+        while (read(fd, rec, sizeof(rec)) > 0) {
+                /* Keep draining */
+        }
+}
+
+/* Drain the driver's trace ring (needs trace=1) into a trace file */
+static void launcher_save_trace(int fd, const char *path)
+{
+        struct launcher_trace_header hdr;
+        struct launcher_trace_record rec[64];
+        FILE *out;
+        ssize_t len;
+        long total = 0;
+
+        out = fopen(path, "wb");
+        if (!out) {
+                perror("Couldn't open trace file");
+                return;
+        }
+
+        hdr.magic = LAUNCHER_TRACE_MAGIC;
+        hdr.version = LAUNCHER_TRACE_VERSION;
+        hdr.record_size = sizeof(struct launcher_trace_record);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+
+        while ((len = read(fd, rec, sizeof(rec))) > 0) {
+                fwrite(rec, len, 1, out);
+                total += len / sizeof(rec[0]);
+        }
+
+        if (len < 0) {
+                perror("Couldn't read trace");
+        } else if (total == 0) {
+                fprintf(stderr, "No trace records - was the module loaded with trace=1?\n");
+        }
+        fclose(out);
+}
+
 static void launcher_usage(char *name)
 {
-        fprintf(stderr, "Usage: %s [-mfslrudh] [-t <msecs>]\n"
+        fprintf(stderr, "Usage: %s [-mfslrudZph] [-t <msecs>] [-o <file>] [-z <zone>]\n"
                         "\t-m\tmissile launcher [" LAUNCHER_NODE "]\n"
                         "\t-f\tfire\n"
                         "\t-s\tstop\n"
@@ -40,10 +126,16 @@ static void launcher_usage(char *name)
                         "\t-u\tturn up\n"
                         "\t-d\tturn down\n"
                         "\t-t\tspecify duration to wait before sending STOP in milliseconds\n"
+                        "\t-o\tsave the driver's command/status trace to a file\n"
+                        "\t-z\tset keep-out zone 'index,pan_min,pan_max,tilt_min,tilt_max,flags'\n"
+                        "\t\t(ms of travel from the left/bottom limits, flags 1 no-move, 2 no-fire)\n"
+                        "\t-Z\tclear all keep-out zones\n"
+                        "\t-p\tprint the dead-reckoned position, zone and transfer statistics\n"
                         "\t-h\tdisplay this help\n\n"
                         "Notes:\n"
                         "\tIt is possible to combine the directions of the two axis, e.g.\n"
                         "\t'-lu' send_cmds the missile launcher up and left at the same time.\n"
+                        "\tWith only -z, -Z or -p given no command is sent.\n"
                         "" , name);
         exit(1);
 }
@@ -55,39 +147,66 @@ int main(int argc, char **argv)
         int fd;
         int cmd = LAUNCHER_STOP;
         char *dev = LAUNCHER_NODE;
+        char *trace_file = NULL;
+        char *zones[8];
+        int nzones = 0;
+        int clear_zones = 0;
+        int print_state = 0;
+        int have_cmd = 0;
         unsigned int duration = 500;
 
         if (argc < 2) {
                 launcher_usage(argv[0]);
         }
 
-        while ((c = getopt(argc, argv, "m:lrudfsht:")) != -1) {
+        while ((c = getopt(argc, argv, "m:lrudfsht:o:z:Zp")) != -1) {
                 switch (c) {
                 case 'm':
                         dev = optarg;
                         break;
                 case 'l':
                         cmd = LAUNCHER_LEFT;
+                        have_cmd = 1;
                         break;
                 case 'r':
                         cmd = LAUNCHER_RIGHT;
+                        have_cmd = 1;
                         break;
                 case 'u':
                         cmd = LAUNCHER_UP;
+                        have_cmd = 1;
                         break;
                 case 'd':
                         cmd = LAUNCHER_DOWN;
+                        have_cmd = 1;
                         break;
                 case 'f': 
                         cmd = LAUNCHER_FIRE;
+                        have_cmd = 1;
                         break;
                 case 's':       
                         cmd = LAUNCHER_STOP;
+                        have_cmd = 1;
                         break;
                 case 't':
                         duration = strtol(optarg, NULL, 10);
                         fprintf(stdout, "Duration set to %d\n", duration);
                         break;
+                case 'o':
+                        trace_file = optarg;
+                        break;
+                case 'z':
+                        if (nzones == sizeof(zones) / sizeof(zones[0])) {
+                                launcher_usage(argv[0]);
+                        }
+                        zones[nzones++] = optarg;
+                        break;
+                case 'Z':
+                        clear_zones = 1;
+                        break;
+                case 'p':
+                        print_state = 1;
+                        break;
                 default:
                         launcher_usage(argv[0]);
                         break;
@@ -99,9 +218,32 @@ int main(int argc, char **argv)
                 perror("Couldn't open file: %m");
                 exit(1);
         }
-        launcher_cmd(fd, cmd);
-        usleep(duration * 1000);
-        launcher_cmd(fd, LAUNCHER_STOP);
+        if (clear_zones && ioctl(fd, LAUNCHER_IOC_CLEAR_ZONES) < 0) {
+                perror("Could not clear zones");
+        }
+        for (c = 0; c < nzones; ++c) {
+                launcher_set_zone(fd, zones[c]);
+        }
+
+        if (trace_file) {
+                launcher_discard_trace(fd);
+        }
+
+        if (have_cmd || !(nzones || clear_zones || print_state)) {
+                launcher_cmd(fd, cmd);
+                if (LAUNCHER_FIRE == cmd) {
+                        usleep(5000000);
+                } else {
+                        usleep(duration * 1000);
+                        launcher_cmd(fd, LAUNCHER_STOP);
+                }
+        }
+        if (print_state) {
+                launcher_print_state(fd);
+        }
+        if (trace_file) {
+                launcher_save_trace(fd, trace_file);
+        }
         close(fd);
         return EXIT_SUCCESS;
 }
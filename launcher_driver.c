@@ -18,11 +18,21 @@
 #include <linux/kernel.h>
 #include <linux/usb.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/usb.h>
 #include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/completion.h>
 #include <linux/ioctl.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+#include <linux/wait.h>
+#include <linux/debugfs.h>
 #include <asm/uaccess.h>
 
+#include "launcher.h"
+
 /* Rocket launcher specifics */
 #define LAUNCHER_VENDOR_ID              0x2123
 #define LAUNCHER_PRODUCT_ID             0x1010
@@ -34,6 +44,8 @@
 #define LAUNCHER_CTRL_VALUE             0x0        
 #define LAUNCHER_CTRL_INDEX             0x0
 #define LAUNCHER_CTRL_COMMAND_PREFIX    0x02
+#define LAUNCHER_CTRL_TIMEOUT_MS        5000
+#define LAUNCHER_TRACE_MAX_RECORDS      (1 << 20)       /* Upper bound on trace_records */
 
 #define LAUNCHER_STOP                   0x20
 #define LAUNCHER_UP                     0x02
@@ -45,6 +57,12 @@
 #define LAUNCHER_UP_RIGHT               (LAUNCHER_UP | LAUNCHER_RIGHT)
 #define LAUNCHER_DOWN_RIGHT             (LAUNCHER_DOWN | LAUNCHER_RIGHT)
 #define LAUNCHER_FIRE                   0x10
+#define LAUNCHER_MOTION_MASK            (LAUNCHER_UP | LAUNCHER_DOWN | LAUNCHER_LEFT | LAUNCHER_RIGHT)
+
+/* Progress of a zone clamp from the interrupt handler, for its latency */
+#define LAUNCHER_CLAMP_NONE             0
+#define LAUNCHER_CLAMP_PENDING          1       /* Waiting for ctrl_urb to be free */
+#define LAUNCHER_CLAMP_SENT             2       /* On the wire in ctrl_urb */
 
 #define LAUNCHER_MAX_UP                 0x80            /* 80 00 00 00 00 00 00 00 */
 #define LAUNCHER_MAX_DOWN               0x40            /* 40 00 00 00 00 00 00 00 */
@@ -52,7 +70,15 @@
 #define LAUNCHER_MAX_RIGHT              0x08            /* 00 08 00 00 00 00 00 00 */
 
 static struct usb_class_driver class;
-static DEFINE_MUTEX(disconnect_mutex);
+static struct dentry *launcher_debugfs;
+
+static bool trace;
+module_param(trace, bool, 0444);
+MODULE_PARM_DESC(trace, "Record command/status traffic, drained with read() or debugfs (default: off)");
+
+static unsigned int trace_records = 4096;
+module_param(trace_records, uint, 0444);
+MODULE_PARM_DESC(trace_records, "Trace ring size per device, rounded up to a power of two, at most 1048576 (default: 4096)");
 
 struct usb_ml {
         struct usb_device               *udev;
@@ -60,20 +86,56 @@ struct usb_ml {
         unsigned char                   minor;
         char                            serial_number[8];
 
+        struct kref                     kref;                   /* Probe plus one per open file */
+        int                             disconnected;           /* Set once unplugged, under sem */
         int                             open_count;             /* Open count for this port */
         struct                          semaphore sem;          /* Locks this structure */
         spinlock_t                      cmd_spinlock;           /* locks dev->command */
 
+        /* One coherent block holds int_in_buffer, ctrl_buffer and write_buffer */
+        void                            *dma_buffer;
+        dma_addr_t                      dma_buffer_dma;
+        size_t                          dma_buffer_size;
+
         char                            *int_in_buffer;
         struct usb_endpoint_descriptor  *int_in_endpoint;
         struct urb                      *int_in_urb;
         int                             int_in_running;
 
-        char                            *ctrl_buffer;           /* 8 byte buffer for the control msg */
+        char                            *ctrl_buffer;           /* 8 byte buffer for corrections */
         struct urb                      *ctrl_urb;
-        struct usb_ctrlrequest          *ctrl_dr;               /* Setup packet information */
-        int                             correction_required;
-        unsigned char                   command;                /* Last issued command */
+        struct usb_ctrlrequest          ctrl_dr;                /* Setup packet information */
+        int                             correction_required;    /* Under cmd_spinlock, as are... */
+        int                             ctrl_in_flight;         /* ...ctrl_urb submitted, not completed */
+        int                             clamp_state;            /* ...LAUNCHER_CLAMP_* */
+        ktime_t                         clamp_arrival;          /* ...status report that caused the clamp */
+        unsigned char                   command;                /* ...and the last issued command */
+
+        char                            *write_buffer;          /* 8 byte buffer for write() */
+        struct urb                      *write_urb;
+        struct usb_ctrlrequest          write_dr;
+        struct completion               write_done;
+
+        atomic_t                        writes;
+        atomic_t                        corrections;
+        atomic_t                        status_reports;
+
+        /* Dead reckoning and keep-out zones, also locked by cmd_spinlock */
+        s64                             pan_us;
+        s64                             tilt_us;
+        ktime_t                         position_time;          /* When pan/tilt were last advanced */
+        s64                             lookahead_us;           /* One interrupt interval of travel */
+        struct launcher_zone            zones[LAUNCHER_MAX_ZONES];
+        struct launcher_state           zone_stats;             /* Counters and latencies only */
+
+        struct launcher_trace_record    *trace_buffer;          /* NULL unless tracing */
+        unsigned int                    trace_head;
+        unsigned int                    trace_tail;
+        unsigned char                   trace_status[LAUNCHER_TRACE_DATA_SIZE]; /* Last status recorded */
+        int                             trace_status_len;
+        spinlock_t                      trace_spinlock;         /* locks the trace ring */
+        wait_queue_head_t               trace_wait;             /* Blocking debugfs readers */
+        struct dentry                   *trace_dentry;
 };
 
 /* Table of devices that work with this driver */
@@ -90,11 +152,322 @@ static struct usb_driver launcher_driver =
         .id_table = launcher_table,
 };
 
+/*
+ * Called from both process and interrupt context - must not sleep. Status
+ * reports are only recorded when they differ from the last one, the device
+ * repeats the same report at every poll while nothing changes.
+ */
+static void launcher_trace(struct usb_ml *dev, __u8 type, const void *data, int len)
+{
+        struct launcher_trace_record *rec;
+        unsigned long flags;
+        unsigned int used;
+        __u32 lost;
+        u64 now;
+
+        if (!dev->trace_buffer) {
+                return;
+        }
+
+        now = ktime_to_ns(ktime_get());
+        if (len > LAUNCHER_TRACE_DATA_SIZE) {
+                len = LAUNCHER_TRACE_DATA_SIZE;
+        }
+
+        spin_lock_irqsave(&dev->trace_spinlock, flags);
+
+        if (type == LAUNCHER_TRACE_STATUS) {
+                if (len == dev->trace_status_len && !memcmp(dev->trace_status, data, len)) {
+                        spin_unlock_irqrestore(&dev->trace_spinlock, flags);
+                        return;
+                }
+                memcpy(dev->trace_status, data, len);
+                dev->trace_status_len = len;
+        }
+
+        used = dev->trace_head - dev->trace_tail;
+        if (used >= trace_records) {
+                /* Full - the newest entry is already an overflow marker. */
+                rec = &dev->trace_buffer[(dev->trace_head - 1) & (trace_records - 1)];
+                memcpy(&lost, rec->data, sizeof(lost));
+                ++lost;
+                memcpy(rec->data, &lost, sizeof(lost));
+                goto unlock;
+        }
+
+        rec = &dev->trace_buffer[dev->trace_head & (trace_records - 1)];
+        memset(rec, 0, sizeof(*rec));
+        rec->timestamp_ns = now;
+
+        if (used == trace_records - 1) {
+                /* Keep the oldest records intact and mark the gap instead. */
+                lost = 1;
+                rec->type = LAUNCHER_TRACE_OVERFLOW;
+                rec->length = sizeof(lost);
+                memcpy(rec->data, &lost, sizeof(lost));
+        } else {
+                rec->type = type;
+                rec->length = len;
+                memcpy(rec->data, data, len);
+        }
+        ++dev->trace_head;
+
+unlock:
+        spin_unlock_irqrestore(&dev->trace_spinlock, flags);
+        wake_up_interruptible(&dev->trace_wait);
+}
+
+static int launcher_trace_pending(struct usb_ml *dev)
+{
+        unsigned long flags;
+        int pending;
+
+        spin_lock_irqsave(&dev->trace_spinlock, flags);
+        pending = dev->trace_head != dev->trace_tail;
+        spin_unlock_irqrestore(&dev->trace_spinlock, flags);
+        return pending;
+}
+
+/* Move whole records to user space, oldest first, without blocking. */
+static ssize_t launcher_trace_copy(struct usb_ml *dev, char __user *user_buf, size_t count)
+{
+        struct launcher_trace_record rec;
+        unsigned long flags;
+        ssize_t retval = 0;
+
+        while (count - retval >= sizeof(rec)) {
+                spin_lock_irqsave(&dev->trace_spinlock, flags);
+                if (dev->trace_tail == dev->trace_head) {
+                        spin_unlock_irqrestore(&dev->trace_spinlock, flags);
+                        break;
+                }
+                rec = dev->trace_buffer[dev->trace_tail & (trace_records - 1)];
+                ++dev->trace_tail;
+                spin_unlock_irqrestore(&dev->trace_spinlock, flags);
+
+                if (copy_to_user(user_buf + retval, &rec, sizeof(rec))) {
+                        if (!retval) {
+                                retval = -EFAULT;
+                        }
+                        break;
+                }
+                retval += sizeof(rec);
+        }
+
+        return retval;
+}
+
+/*
+ * Bring pan/tilt up to date with the motion in dev->command. Hold
+ * cmd_spinlock. Callers may sample now before taking the lock, so a now
+ * older than position_time is ignored rather than moving it backwards.
+ */
+static void launcher_advance_position(struct usb_ml *dev, ktime_t now)
+{
+        s64 elapsed = ktime_us_delta(now, dev->position_time);
+
+        if (elapsed <= 0) {
+                return;
+        }
+        dev->position_time = now;
+        if (dev->command & (LAUNCHER_STOP | LAUNCHER_FIRE)) {
+                return;
+        }
+
+        if (dev->command & LAUNCHER_RIGHT) {
+                dev->pan_us += elapsed;
+        } else if (dev->command & LAUNCHER_LEFT) {
+                dev->pan_us -= elapsed;
+        }
+
+        if (dev->command & LAUNCHER_UP) {
+                dev->tilt_us += elapsed;
+        } else if (dev->command & LAUNCHER_DOWN) {
+                dev->tilt_us -= elapsed;
+        }
+}
+
+static int launcher_zone_contains(const struct launcher_zone *zone, s64 pan_us, s64 tilt_us)
+{
+        return pan_us >= zone->pan_min * 1000LL && pan_us <= zone->pan_max * 1000LL &&
+               tilt_us >= zone->tilt_min * 1000LL && tilt_us <= zone->tilt_max * 1000LL;
+}
+
+static int launcher_zones_active(struct usb_ml *dev)
+{
+        return dev->zone_stats.homed == (LAUNCHER_HOMED_PAN | LAUNCHER_HOMED_TILT);
+}
+
+/* Fails closed: with a no-fire zone set, an unhomed turret may be inside it. */
+static int launcher_zone_forbids_fire(struct usb_ml *dev)
+{
+        int active = launcher_zones_active(dev);
+        int i;
+
+        for (i = 0; i < LAUNCHER_MAX_ZONES; ++i) {
+                if (dev->zones[i].flags & LAUNCHER_ZONE_NO_FIRE &&
+                    (!active ||
+                     launcher_zone_contains(&dev->zones[i], dev->pan_us, dev->tilt_us))) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/*
+ * Strip the direction bits of cmd that would carry the turret into a
+ * no-move zone before the next status report. Hold cmd_spinlock.
+ */
+static unsigned char launcher_zone_clamp(struct usb_ml *dev, unsigned char cmd)
+{
+        const struct launcher_zone *zone;
+        s64 pan = dev->pan_us, tilt = dev->tilt_us;
+        s64 pan_next = pan, tilt_next = tilt;
+        int i;
+
+        if (!(cmd & LAUNCHER_MOTION_MASK) || cmd & LAUNCHER_STOP || !launcher_zones_active(dev)) {
+                return cmd;
+        }
+
+        for (i = 0; i < LAUNCHER_MAX_ZONES; ++i) {
+                zone = &dev->zones[i];
+                if (!(zone->flags & LAUNCHER_ZONE_NO_MOVE)) {
+                        continue;
+                }
+
+                if (launcher_zone_contains(zone, pan, tilt)) {
+                        /* Already inside - only let it back out the nearest way. */
+                        if (pan - zone->pan_min * 1000LL <= zone->pan_max * 1000LL - pan) {
+                                cmd &= ~LAUNCHER_RIGHT;
+                        } else {
+                                cmd &= ~LAUNCHER_LEFT;
+                        }
+                        if (tilt - zone->tilt_min * 1000LL <= zone->tilt_max * 1000LL - tilt) {
+                                cmd &= ~LAUNCHER_UP;
+                        } else {
+                                cmd &= ~LAUNCHER_DOWN;
+                        }
+                        continue;
+                }
+
+                if (cmd & LAUNCHER_LEFT &&
+                    launcher_zone_contains(zone, pan - dev->lookahead_us, tilt)) {
+                        cmd &= ~LAUNCHER_LEFT;
+                }
+                if (cmd & LAUNCHER_RIGHT &&
+                    launcher_zone_contains(zone, pan + dev->lookahead_us, tilt)) {
+                        cmd &= ~LAUNCHER_RIGHT;
+                }
+                if (cmd & LAUNCHER_DOWN &&
+                    launcher_zone_contains(zone, pan, tilt - dev->lookahead_us)) {
+                        cmd &= ~LAUNCHER_DOWN;
+                }
+                if (cmd & LAUNCHER_UP &&
+                    launcher_zone_contains(zone, pan, tilt + dev->lookahead_us)) {
+                        cmd &= ~LAUNCHER_UP;
+                }
+        }
+
+        /* A diagonal can clip a corner that neither axis reaches on its own. */
+        if (cmd & LAUNCHER_LEFT) {
+                pan_next -= dev->lookahead_us;
+        } else if (cmd & LAUNCHER_RIGHT) {
+                pan_next += dev->lookahead_us;
+        }
+        if (cmd & LAUNCHER_DOWN) {
+                tilt_next -= dev->lookahead_us;
+        } else if (cmd & LAUNCHER_UP) {
+                tilt_next += dev->lookahead_us;
+        }
+        for (i = 0; i < LAUNCHER_MAX_ZONES; ++i) {
+                zone = &dev->zones[i];
+                if (zone->flags & LAUNCHER_ZONE_NO_MOVE &&
+                    !launcher_zone_contains(zone, pan, tilt) &&
+                    launcher_zone_contains(zone, pan_next, tilt_next)) {
+                        cmd &= ~LAUNCHER_MOTION_MASK;
+                }
+        }
+
+        if (!(cmd & LAUNCHER_MOTION_MASK)) {
+                cmd = LAUNCHER_STOP;
+        }
+        return cmd;
+}
+
+static void launcher_record_latency(__u32 *last, __u32 *max, ktime_t since)
+{
+        s64 ns = ktime_to_ns(ktime_sub(ktime_get(), since));
+
+        *last = ns > U32_MAX ? U32_MAX : ns;
+        if (*last > *max) {
+                *max = *last;
+        }
+}
+
+static void launcher_write_callback(struct urb *urb)
+{
+        struct usb_ml *dev = urb->context;
+
+        complete(&dev->write_done);
+}
+
+/*
+ * Send dev->command on ctrl_urb. Hold cmd_spinlock and make sure the URB
+ * is idle - a correction needed while it is busy is left in
+ * correction_required for launcher_ctrl_callback() to send.
+ */
+static void launcher_submit_correction(struct usb_ml *dev)
+{
+        int retval;
+
+        if (!dev->command) {
+                dev->command = LAUNCHER_STOP;
+        }
+        dev->ctrl_buffer[0] = LAUNCHER_CTRL_COMMAND_PREFIX;
+        dev->ctrl_buffer[1] = dev->command;
+        dev->correction_required = 0;
+        dev->ctrl_in_flight = 1;
+        if (dev->clamp_state == LAUNCHER_CLAMP_PENDING) {
+                dev->clamp_state = LAUNCHER_CLAMP_SENT;
+        }
+
+        launcher_trace(dev, LAUNCHER_TRACE_CORRECTION, &dev->ctrl_buffer[1], 1);
+        retval = usb_submit_urb(dev->ctrl_urb, GFP_ATOMIC);
+        if (retval) {
+                pr_err("submitting correction control URB failed (%d)", retval);
+                dev->ctrl_in_flight = 0;
+                dev->clamp_state = LAUNCHER_CLAMP_NONE;
+        } else {
+                atomic_inc(&dev->corrections);
+        }
+}
+
 static void launcher_ctrl_callback(struct urb *urb)
 {
         struct usb_ml *dev = urb->context;
+        unsigned long flags;
+
         pr_debug("launcher_ctrl_callback\n");
-        dev->correction_required = 0;        /* TODO: do we need race protection? */
+
+        spin_lock_irqsave(&dev->cmd_spinlock, flags);
+        dev->ctrl_in_flight = 0;
+
+        /* A clamp only counts once the device has the stop. */
+        if (dev->clamp_state == LAUNCHER_CLAMP_SENT) {
+                if (!urb->status) {
+                        ++dev->zone_stats.clamps;
+                        launcher_record_latency(&dev->zone_stats.last_clamp_ns,
+                                                &dev->zone_stats.max_clamp_ns,
+                                                dev->clamp_arrival);
+                }
+                dev->clamp_state = LAUNCHER_CLAMP_NONE;
+        }
+
+        /* Send whatever was deferred while this one was on the wire. */
+        if (dev->correction_required && dev->int_in_running && !dev->disconnected) {
+                launcher_submit_correction(dev);
+        }
+        spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
 }
 
 static void launcher_abort_transfers(struct usb_ml *dev)
@@ -109,12 +482,8 @@ static void launcher_abort_transfers(struct usb_ml *dev)
                 return;
         }
 
-        if (dev->udev->state == USB_STATE_NOTATTACHED) {
-                pr_err("udev not attached");
-                return;
-        }
-
-        /* Shutdown transfer */
+        /* Shutdown transfer - safe even once the device is gone, and the
+         * URBs must be idle before launcher_delete() frees them. */
         if (dev->int_in_running) {
                 dev->int_in_running = 0;
                 mb();
@@ -126,11 +495,17 @@ static void launcher_abort_transfers(struct usb_ml *dev)
         if (dev->ctrl_urb) {
                 usb_kill_urb(dev->ctrl_urb);
         }
+
+        if (dev->write_urb) {
+                usb_kill_urb(dev->write_urb);
+        }
 }
 
 static void launcher_int_in_callback(struct urb *urb)
 {
         struct usb_ml *dev = urb->context;
+        ktime_t arrival = ktime_get();
+        unsigned char clamped;
         int retval;
         int i;
 
@@ -158,8 +533,21 @@ static void launcher_int_in_callback(struct urb *urb)
         }
 
         if (urb->actual_length > 0) {
+                atomic_inc(&dev->status_reports);
+                launcher_trace(dev, LAUNCHER_TRACE_STATUS, dev->int_in_buffer, urb->actual_length);
+
                 spin_lock(&dev->cmd_spinlock);
 
+                launcher_advance_position(dev, arrival);
+                if (dev->int_in_buffer[1] & LAUNCHER_MAX_LEFT) {
+                        dev->pan_us = 0;
+                        dev->zone_stats.homed |= LAUNCHER_HOMED_PAN;
+                }
+                if (dev->int_in_buffer[0] & LAUNCHER_MAX_DOWN) {
+                        dev->tilt_us = 0;
+                        dev->zone_stats.homed |= LAUNCHER_HOMED_TILT;
+                }
+
                 if (dev->int_in_buffer[0] & LAUNCHER_MAX_UP && dev->command & LAUNCHER_UP) {
                         dev->command &= ~LAUNCHER_UP;
                         dev->correction_required = 1;
@@ -178,33 +566,44 @@ static void launcher_int_in_callback(struct urb *urb)
                         dev->correction_required = 1;
                 }
 
+                clamped = launcher_zone_clamp(dev, dev->command);
+                if (clamped != dev->command) {
+                        dev->command = clamped;
+                        dev->correction_required = 1;
 
-                if (dev->correction_required) {
-                        dev->ctrl_buffer[0] = dev->command;
-                        spin_unlock(&dev->cmd_spinlock);
-                        retval = usb_submit_urb(dev->ctrl_urb, GFP_ATOMIC);
-                        if (retval) {
-                                pr_err("submitting correction control URB failed (%d)", retval);
-                        } 
-                } else {
-                        spin_unlock(&dev->cmd_spinlock);
+                        /* Time from the first report that needed it, if one is already waiting. */
+                        if (dev->clamp_state == LAUNCHER_CLAMP_NONE) {
+                                dev->clamp_state = LAUNCHER_CLAMP_PENDING;
+                                dev->clamp_arrival = arrival;
+                        }
                 }
+
+                if (dev->correction_required && !dev->ctrl_in_flight) {
+                        launcher_submit_correction(dev);
+                }
+                spin_unlock(&dev->cmd_spinlock);
         }
 
 resubmit:
         /* Resubmit if we're still running. */
-        if (dev->int_in_running && dev->udev) {
+        if (dev->int_in_running && !dev->disconnected) {
                 retval = usb_submit_urb(dev->int_in_urb, GFP_ATOMIC);
                 if (retval) {
                         pr_err("resubmitting urb failed (%d)", retval);
                         dev->int_in_running = 0;
+
+                        /* Tracking has lapsed until launcher_open() restarts it. */
+                        spin_lock(&dev->cmd_spinlock);
+                        dev->zone_stats.homed = 0;
+                        spin_unlock(&dev->cmd_spinlock);
                 }
         }
 }
 
-static inline void launcher_delete(struct usb_ml *dev)
+/* Called on the last kref_put(), transfers have been stopped by then. */
+static void launcher_delete(struct kref *kref)
 {
-        launcher_abort_transfers(dev);
+        struct usb_ml *dev = container_of(kref, struct usb_ml, kref);
 
         /* Free data structures. */
         if (dev->int_in_urb) {
@@ -213,13 +612,59 @@ static inline void launcher_delete(struct usb_ml *dev)
         if (dev->ctrl_urb) {
                 usb_free_urb(dev->ctrl_urb);
         }
+        if (dev->write_urb) {
+                usb_free_urb(dev->write_urb);
+        }
 
-        kfree(dev->int_in_buffer);
-        kfree(dev->ctrl_buffer);
-        kfree(dev->ctrl_dr);
+        if (dev->dma_buffer) {
+                usb_free_coherent(dev->udev, dev->dma_buffer_size, dev->dma_buffer,
+                                  dev->dma_buffer_dma);
+        }
+        vfree(dev->trace_buffer);
+        usb_put_intf(dev->interface);
+        usb_put_dev(dev->udev);
         kfree(dev);
 }
  
+/*
+ * Send one command and wait until the device has it. Hold dev->sem, it
+ * keeps the write URB to one sender at a time.
+ *
+ * This goes through the preallocated write URB rather than
+ * usb_control_msg(), which allocates an URB and setup packet per call
+ * and would need a DMA-safe copy of the data.
+ */
+static int launcher_send_command(struct usb_ml *dev, unsigned char cmd)
+{
+        int retval;
+
+        dev->write_buffer[0] = LAUNCHER_CTRL_COMMAND_PREFIX;
+        dev->write_buffer[1] = cmd;
+        reinit_completion(&dev->write_done);
+
+        pr_debug("Submitting write URB\n");
+        retval = usb_submit_urb(dev->write_urb, GFP_KERNEL);
+        if (retval) {
+                pr_err("submitting write URB failed (%d)", retval);
+                return retval;
+        }
+
+        if (!wait_for_completion_timeout(&dev->write_done,
+                                         msecs_to_jiffies(LAUNCHER_CTRL_TIMEOUT_MS))) {
+                usb_kill_urb(dev->write_urb);
+                retval = -ETIMEDOUT;
+        } else {
+                retval = dev->write_urb->status;
+        }
+
+        if (retval < 0) {
+                pr_err("write URB failed (%d)", retval);
+                return retval;
+        }
+        atomic_inc(&dev->writes);
+        return 0;
+}
+
 static int launcher_open(struct inode *inodep, struct file *filp)
 {
         struct usb_ml *dev = NULL;
@@ -230,8 +675,11 @@ static int launcher_open(struct inode *inodep, struct file *filp)
         pr_debug("launcher_open\n");
         subminor = iminor(inodep);
 
-        mutex_lock(&disconnect_mutex);
-
+        /*
+         * The USB core holds off usb_deregister_dev() while an open is in
+         * flight, so the reference taken here cannot race with the final
+         * kref_put() in launcher_disconnect().
+         */
         interface = usb_find_interface(&launcher_driver, subminor);
         if (!interface) {
                 pr_err("can't find device for minor %d", subminor);
@@ -245,11 +693,18 @@ static int launcher_open(struct inode *inodep, struct file *filp)
                 goto exit;
         }
 
+        kref_get(&dev->kref);
+
         /* lock this device */
         if (down_interruptible(&dev->sem)) {
                 pr_err("sem down failed");
                 retval = -ERESTARTSYS;
-                goto exit;
+                goto put_exit;
+        }
+
+        if (dev->disconnected) {
+                retval = -ENODEV;
+                goto unlock_exit;
         }
 
         /* Increment our usage count for the device. */
@@ -261,24 +716,27 @@ static int launcher_open(struct inode *inodep, struct file *filp)
                 goto unlock_exit;
         }
 
-        /* Initialize interrupt URB. */
-        usb_fill_int_urb(dev->int_in_urb, dev->udev,
-                         usb_rcvintpipe(dev->udev, dev->int_in_endpoint->bEndpointAddress),
-                         dev->int_in_buffer,
-                         le16_to_cpu(dev->int_in_endpoint->wMaxPacketSize),
-                         launcher_int_in_callback,
-                         dev,
-                         dev->int_in_endpoint->bInterval);
+        /* Record the first status report of each open as a baseline. */
+        spin_lock_irq(&dev->trace_spinlock);
+        dev->trace_status_len = 0;
+        spin_unlock_irq(&dev->trace_spinlock);
 
-        dev->int_in_running = 1;
-        mb();
+        /* Polling runs from probe, only restart it if a resubmit failed. */
+        if (!dev->int_in_running) {
+                spin_lock_irq(&dev->cmd_spinlock);
+                dev->position_time = ktime_get();
+                spin_unlock_irq(&dev->cmd_spinlock);
 
-        retval = usb_submit_urb(dev->int_in_urb, GFP_KERNEL);
-        if (retval) {
-                pr_err("submitting int urb failed (%d)", retval);
-                dev->int_in_running = 0;
-                --dev->open_count;
-                goto unlock_exit;
+                dev->int_in_running = 1;
+                mb();
+
+                retval = usb_submit_urb(dev->int_in_urb, GFP_KERNEL);
+                if (retval) {
+                        pr_err("submitting int urb failed (%d)", retval);
+                        dev->int_in_running = 0;
+                        --dev->open_count;
+                        goto unlock_exit;
+                }
         }
 
         /* Save our object in the file's private structure. */
@@ -287,11 +745,39 @@ static int launcher_open(struct inode *inodep, struct file *filp)
 unlock_exit:
         up(&dev->sem);
 
+put_exit:
+        /* On success the reference is dropped in launcher_close(). */
+        if (retval) {
+                kref_put(&dev->kref, launcher_delete);
+        }
+
 exit:
-        mutex_unlock(&disconnect_mutex);
         return retval;
 }
 
+/*
+ * Stop a launcher left moving by a closing (or crashed) process rather
+ * than leave it to run into a limit switch or zone edge. Hold dev->sem.
+ */
+static void launcher_stop_motion(struct usb_ml *dev)
+{
+        unsigned char stop = LAUNCHER_STOP;
+        int moving;
+
+        spin_lock_irq(&dev->cmd_spinlock);
+        launcher_advance_position(dev, ktime_get());
+        moving = dev->command & LAUNCHER_MOTION_MASK && !(dev->command & LAUNCHER_STOP);
+        dev->command = LAUNCHER_STOP;
+        spin_unlock_irq(&dev->cmd_spinlock);
+
+        if (moving) {
+                launcher_trace(dev, LAUNCHER_TRACE_CORRECTION, &stop, sizeof(stop));
+                if (launcher_send_command(dev, stop)) {
+                        pr_err("could not stop the launcher on close");
+                }
+        }
+}
+
 static int launcher_close(struct inode *inodep, struct file *filp)
 {       struct usb_ml *dev = NULL;
         int retval = 0;
@@ -305,11 +791,8 @@ static int launcher_close(struct inode *inodep, struct file *filp)
                 goto exit;
         }
 
-        /* Lock our device */
-        if (down_interruptible(&dev->sem)) {
-                retval = -ERESTARTSYS;
-                goto exit;
-        }
+        /* Lock our device - not interruptible, we must drop our reference */
+        down(&dev->sem);
 
         if (dev->open_count <= 0) {
                 pr_err("device not opened");
@@ -317,41 +800,132 @@ static int launcher_close(struct inode *inodep, struct file *filp)
                 goto unlock_exit;
         }
 
-        if (! dev->udev) {
+        if (dev->disconnected) {
                 pr_warn("device unplugged before the file was released");
-                up (&dev->sem);        /* Unlock here as LAUNCHER_delete frees dev. */
-                launcher_delete(dev);
-                goto exit;
+        } else {
+                /* The interrupt URB keeps tracking until disconnect. */
+                launcher_stop_motion(dev);
         }
 
         if (dev->open_count > 1) {
                 pr_info("open_count = %d", dev->open_count);
         }
 
-        launcher_abort_transfers(dev);
         --dev->open_count;
 
 unlock_exit:
         up(&dev->sem);
 
+        /* Frees dev if the launcher has already been unplugged. */
+        kref_put(&dev->kref, launcher_delete);
+
 exit:
         return retval;
 }
 
-static ssize_t launcher_read(struct file *f, char __user *buf, size_t cnt, loff_t *off)
+/*
+ * Drain whole trace records, oldest first. Returns 0 once the ring is
+ * empty or when the module was loaded without trace=1. The ring outlives
+ * each open, so whatever was recorded before the open is returned too.
+ */
+static ssize_t launcher_read(struct file *filp, char __user *user_buf,
+                             size_t count, loff_t *off)
 {
-        int retval = -EFAULT;
+        struct usb_ml *dev;
+
         pr_debug("launcher_read\n");
+        dev = filp->private_data;
+
+        if (!dev->trace_buffer) {
+                return 0;
+        }
+
+        return launcher_trace_copy(dev, user_buf, count);
+}
+
+/*
+ * debugfs launcher_driver/launcher<minor>: the same ring, readable while
+ * another process holds the device node open. Reads block until records
+ * arrive and the stream starts with a launcher_trace_header, so
+ * `cat launcher0 > run.trace` captures a trace launcher_replay can load.
+ * Only one reader (this file or read() on the node) should drain at once.
+ */
+static int launcher_trace_open(struct inode *inodep, struct file *filp)
+{
+        struct usb_ml *dev = inodep->i_private;
+
+        /* debugfs_remove() in disconnect waits for opens in flight. */
+        kref_get(&dev->kref);
+        filp->private_data = dev;
+        return nonseekable_open(inodep, filp);
+}
+
+static ssize_t launcher_trace_read(struct file *filp, char __user *user_buf,
+                                   size_t count, loff_t *off)
+{
+        struct usb_ml *dev = filp->private_data;
+        struct launcher_trace_header hdr;
+        ssize_t retval;
+
+        if (*off == 0) {
+                if (count < sizeof(hdr)) {
+                        return -EINVAL;
+                }
+                hdr.magic = LAUNCHER_TRACE_MAGIC;
+                hdr.version = LAUNCHER_TRACE_VERSION;
+                hdr.record_size = sizeof(struct launcher_trace_record);
+                if (copy_to_user(user_buf, &hdr, sizeof(hdr))) {
+                        return -EFAULT;
+                }
+                *off += sizeof(hdr);
+                return sizeof(hdr);
+        }
+
+        if (filp->f_flags & O_NONBLOCK) {
+                if (!launcher_trace_pending(dev) && !dev->disconnected) {
+                        return -EAGAIN;
+                }
+        } else {
+                retval = wait_event_interruptible(dev->trace_wait,
+                                launcher_trace_pending(dev) || dev->disconnected);
+                if (retval) {
+                        return retval;
+                }
+        }
+
+        retval = launcher_trace_copy(dev, user_buf, count);
+        if (retval > 0) {
+                *off += retval;
+        }
         return retval;
 }
 
+static int launcher_trace_release(struct inode *inodep, struct file *filp)
+{
+        struct usb_ml *dev = filp->private_data;
+
+        kref_put(&dev->kref, launcher_delete);
+        return 0;
+}
+
+static const struct file_operations trace_fops =
+{
+        .owner = THIS_MODULE,
+        .open = launcher_trace_open,
+        .read = launcher_trace_read,
+        .release = launcher_trace_release,
+};
+
 static ssize_t launcher_write(struct file *filp, const char __user *user_buf, 
                               size_t count, loff_t *off)
 {
         int retval = -EFAULT;
         struct usb_ml *dev;
-        unsigned char buf[8];
         unsigned char cmd = LAUNCHER_STOP;
+        unsigned char clamped, sent;
+        unsigned long flags;
+        int overtaken;
+        ktime_t entry = ktime_get();
 
         pr_debug("launcher_write\n");
         dev = filp->private_data;
@@ -363,7 +937,7 @@ static ssize_t launcher_write(struct file *filp, const char __user *user_buf,
         }
 
         /* Verify that the device wasn't unplugged. */
-        if (! dev->udev) {
+        if (dev->disconnected) {
                 retval = -ENODEV;
                 pr_err("No device or device unplugged (%d)", retval);
                 goto unlock_exit;
@@ -384,36 +958,65 @@ static ssize_t launcher_write(struct file *filp, const char __user *user_buf,
                 goto unlock_exit;
         }
         
-        pr_info("Received command 0x%x\n", cmd);
+        pr_debug("Received command 0x%x\n", cmd);
+        launcher_trace(dev, LAUNCHER_TRACE_COMMAND, &cmd, sizeof(cmd));
 
         /* TODO: Check the range of the commands allowed - otherwise we're 
          *        trusting the user not to be silly
          */
         
-        memset(&buf, 0, sizeof(buf));
-        buf[0] = LAUNCHER_CTRL_COMMAND_PREFIX;
-        buf[1] = cmd;
-
         /* The interrupt-in-endpoint handler also modifies dev->command. */
-        spin_lock(&dev->cmd_spinlock);
-        dev->command = cmd;
-        spin_unlock(&dev->cmd_spinlock);
+        spin_lock_irqsave(&dev->cmd_spinlock, flags);
+        launcher_advance_position(dev, ktime_get());
+
+        if (cmd & LAUNCHER_FIRE && launcher_zone_forbids_fire(dev)) {
+                ++dev->zone_stats.rejections;
+                launcher_record_latency(&dev->zone_stats.last_reject_ns,
+                                        &dev->zone_stats.max_reject_ns, entry);
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
+                pr_info("Refusing to fire inside, or possibly inside, a no-fire zone\n");
+                retval = -EPERM;
+                goto unlock_exit;
+        }
 
-        pr_debug("Sending usb_control_message()\n");
-        retval = usb_control_msg(dev->udev,
-                        usb_sndctrlpipe(dev->udev, 0),
-                        LAUNCHER_CTRL_REQUEST,
-                        LAUNCHER_CTRL_REQUEST_TYPE,
-                        LAUNCHER_CTRL_VALUE,
-                        LAUNCHER_CTRL_INDEX,
-                        &buf,
-                        sizeof(buf),
-                        HZ*100);        
+        clamped = launcher_zone_clamp(dev, cmd);
+        dev->command = clamped;
+        spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
 
+        if (clamped != cmd) {
+                launcher_trace(dev, LAUNCHER_TRACE_CORRECTION, &clamped, sizeof(clamped));
+        }
 
-        if (retval < 0) {
-                pr_err("usb_control_msg failed (%d)", retval);
-                goto unlock_exit;
+        /*
+         * A correction from the interrupt handler can take ctrl_urb to the
+         * device ahead of this write, which would then overwrite it. Resend
+         * until what the device last got is what dev->command says -
+         * corrections only ever remove motion, so this settles quickly.
+         */
+        sent = clamped;
+        for (;;) {
+                retval = launcher_send_command(dev, sent);
+                if (retval < 0) {
+                        goto unlock_exit;
+                }
+
+                spin_lock_irqsave(&dev->cmd_spinlock, flags);
+                overtaken = dev->command != sent;
+                sent = dev->command;
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
+
+                if (!overtaken) {
+                        break;
+                }
+                launcher_trace(dev, LAUNCHER_TRACE_CORRECTION, &sent, sizeof(sent));
+        }
+
+        if (clamped != cmd) {
+                spin_lock_irqsave(&dev->cmd_spinlock, flags);
+                ++dev->zone_stats.clamps;
+                launcher_record_latency(&dev->zone_stats.last_clamp_ns,
+                                        &dev->zone_stats.max_clamp_ns, entry);
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
         }
 
         /* We've only written one byte hopefully! */
@@ -426,14 +1029,105 @@ exit:
         return retval;
 }
  
+static long launcher_ioctl(struct file *filp, unsigned int ioctl_num,
+                           unsigned long ioctl_param)
+{
+        struct usb_ml *dev;
+        struct launcher_zone zone;
+        struct launcher_state state;
+        struct launcher_xfer_stats xfer;
+        void __user *argp = (void __user *)ioctl_param;
+        unsigned long flags;
+        long retval = 0;
+
+        pr_debug("launcher_ioctl\n");
+        dev = filp->private_data;
+
+        switch (ioctl_num) {
+        case LAUNCHER_IOC_SET_ZONE:
+                if (copy_from_user(&zone, argp, sizeof(zone))) {
+                        retval = -EFAULT;
+                        break;
+                }
+                if (zone.index >= LAUNCHER_MAX_ZONES || zone.pan_min > zone.pan_max ||
+                    zone.tilt_min > zone.tilt_max) {
+                        retval = -EINVAL;
+                        break;
+                }
+                spin_lock_irqsave(&dev->cmd_spinlock, flags);
+                dev->zones[zone.index] = zone;
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
+                break;
+
+        case LAUNCHER_IOC_GET_XFER_STATS:
+                xfer.writes = atomic_read(&dev->writes);
+                xfer.corrections = atomic_read(&dev->corrections);
+                xfer.status_reports = atomic_read(&dev->status_reports);
+                if (copy_to_user(argp, &xfer, sizeof(xfer))) {
+                        retval = -EFAULT;
+                }
+                break;
+
+        case LAUNCHER_IOC_CLEAR_ZONES:
+                spin_lock_irqsave(&dev->cmd_spinlock, flags);
+                memset(dev->zones, 0, sizeof(dev->zones));
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
+                break;
+
+        case LAUNCHER_IOC_GET_STATE:
+                spin_lock_irqsave(&dev->cmd_spinlock, flags);
+                launcher_advance_position(dev, ktime_get());
+                state = dev->zone_stats;
+                state.pan = div_s64(dev->pan_us, 1000);
+                state.tilt = div_s64(dev->tilt_us, 1000);
+                spin_unlock_irqrestore(&dev->cmd_spinlock, flags);
+                if (copy_to_user(argp, &state, sizeof(state))) {
+                        retval = -EFAULT;
+                }
+                break;
+
+        default:
+                retval = -ENOTTY;
+                break;
+        }
+
+        return retval;
+}
+ 
 static struct file_operations fops =
 {
+        .owner = THIS_MODULE,
         .open = launcher_open,
         .release = launcher_close,
         .read = launcher_read,
         .write = launcher_write,
+        .unlocked_ioctl = launcher_ioctl,
 };
  
+/* Point a control URB at a setup packet and 8 byte slice of dev->dma_buffer. */
+static void launcher_fill_ctrl_urb(struct usb_ml *dev, struct urb *urb,
+                                   struct usb_ctrlrequest *dr, char *buffer,
+                                   dma_addr_t buffer_dma, usb_complete_t callback)
+{
+        dr->bRequestType = LAUNCHER_CTRL_REQUEST_TYPE;
+        dr->bRequest = LAUNCHER_CTRL_REQUEST;
+        dr->wValue = cpu_to_le16(LAUNCHER_CTRL_VALUE);
+        dr->wIndex = cpu_to_le16(LAUNCHER_CTRL_INDEX);
+        dr->wLength = cpu_to_le16(LAUNCHER_CTRL_BUFFER_SIZE);
+
+        buffer[0] = LAUNCHER_CTRL_COMMAND_PREFIX;
+
+        usb_fill_control_urb(urb, dev->udev,
+                        usb_sndctrlpipe(dev->udev, 0),
+                        (unsigned char *)dr,
+                        buffer,
+                        LAUNCHER_CTRL_BUFFER_SIZE,
+                        callback,
+                        dev);
+        urb->transfer_dma = buffer_dma;
+        urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+}
+
 static int launcher_probe(struct usb_interface *interface, const struct usb_device_id *id)
 {
         struct usb_device *udev = interface_to_usbdev(interface);
@@ -445,18 +1139,6 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
 
         pr_debug("launcher_probe\n");
         
-        /* Set up our class */
-        class.name = LAUNCHER_NODE"%d";
-        class.fops = &fops;
-        
-        if ((retval = usb_register_dev(interface, &class)) < 0) {
-                /* Something stopped us from registering this driver */
-                pr_err("Not able to get a minor for this device.");
-                goto exit;
-        } else {
-                pr_info("Minor receieved - %d\n", interface->minor);
-        }
-        
         if (!udev) {
                 /* Something has gone bad */
                 pr_err("udev is NULL");
@@ -472,11 +1154,24 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
 
         dev->command = LAUNCHER_STOP;
 
+        kref_init(&dev->kref);
         sema_init(&dev->sem, 1);
         spin_lock_init(&dev->cmd_spinlock);
+        spin_lock_init(&dev->trace_spinlock);
+        init_waitqueue_head(&dev->trace_wait);
+
+        if (trace) {
+                dev->trace_buffer = vmalloc(trace_records *
+                                            sizeof(struct launcher_trace_record));
+                if (!dev->trace_buffer) {
+                        pr_err("could not allocate trace_buffer");
+                        retval = -ENOMEM;
+                        goto error;
+                }
+        }
 
-        dev->udev = udev;
-        dev->interface = interface;
+        dev->udev = usb_get_dev(udev);
+        dev->interface = usb_get_intf(interface);
         iface_desc = interface->cur_altsetting;
 
         /* Set up interrupt endpoint information. */
@@ -497,12 +1192,29 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
 
         int_end_size = le16_to_cpu(dev->int_in_endpoint->wMaxPacketSize);
 
-        dev->int_in_buffer = kmalloc(int_end_size, GFP_KERNEL);
-        if (!dev->int_in_buffer) {
-                pr_err("could not allocate int_in_buffer");
+        /* Low/full speed: bInterval is the polling period in milliseconds. */
+        dev->lookahead_us = max_t(int, dev->int_in_endpoint->bInterval, 1) * USEC_PER_MSEC;
+
+        /*
+         * Allocate every transfer buffer and URB once, here, so that neither
+         * write() nor the interrupt handler allocates. The buffers are
+         * DMA-coherent so their data is never mapped or bounced; what the
+         * host controller does with each control URB's setup packet is up
+         * to it.
+         */
+        dev->dma_buffer_size = int_end_size + 2 * LAUNCHER_CTRL_BUFFER_SIZE;
+        dev->dma_buffer = usb_alloc_coherent(udev, dev->dma_buffer_size, GFP_KERNEL,
+                                             &dev->dma_buffer_dma);
+        if (!dev->dma_buffer) {
+                pr_err("could not allocate transfer buffers");
                 retval = -ENOMEM;
                 goto error;
         }
+        memset(dev->dma_buffer, 0, dev->dma_buffer_size);
+
+        dev->int_in_buffer = dev->dma_buffer;
+        dev->ctrl_buffer = dev->int_in_buffer + int_end_size;
+        dev->write_buffer = dev->ctrl_buffer + LAUNCHER_CTRL_BUFFER_SIZE;
 
         dev->int_in_urb = usb_alloc_urb(0, GFP_KERNEL);
         if (!dev->int_in_urb) {
@@ -511,7 +1223,17 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
                 goto error;
         }
 
-        /* Set up the control URB. */
+        usb_fill_int_urb(dev->int_in_urb, dev->udev,
+                         usb_rcvintpipe(dev->udev, dev->int_in_endpoint->bEndpointAddress),
+                         dev->int_in_buffer,
+                         int_end_size,
+                         launcher_int_in_callback,
+                         dev,
+                         dev->int_in_endpoint->bInterval);
+        dev->int_in_urb->transfer_dma = dev->dma_buffer_dma;
+        dev->int_in_urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+        /* Set up the control URBs - corrections from the interrupt handler and write(). */
         dev->ctrl_urb = usb_alloc_urb(0, GFP_KERNEL);
         if (!dev->ctrl_urb) {
                 pr_err("could not allocate ctrl_urb");
@@ -519,32 +1241,20 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
                 goto error;
         }
 
-        dev->ctrl_buffer = kzalloc(LAUNCHER_CTRL_BUFFER_SIZE, GFP_KERNEL);
-        if (!dev->ctrl_buffer) {
-                pr_err("could not allocate ctrl_buffer");
-                retval = -ENOMEM;
-                goto error;
-        }
+        launcher_fill_ctrl_urb(dev, dev->ctrl_urb, &dev->ctrl_dr, dev->ctrl_buffer,
+                               dev->dma_buffer_dma + int_end_size, launcher_ctrl_callback);
 
-        dev->ctrl_dr = kmalloc(sizeof(struct usb_ctrlrequest), GFP_KERNEL);
-        if (!dev->ctrl_dr) {
-                pr_err("could not allocate usb_ctrlrequest");
+        dev->write_urb = usb_alloc_urb(0, GFP_KERNEL);
+        if (!dev->write_urb) {
+                pr_err("could not allocate write_urb");
                 retval = -ENOMEM;
                 goto error;
         }
-        dev->ctrl_dr->bRequestType = LAUNCHER_CTRL_REQUEST_TYPE;
-        dev->ctrl_dr->bRequest = LAUNCHER_CTRL_REQUEST;
-        dev->ctrl_dr->wValue = cpu_to_le16(LAUNCHER_CTRL_VALUE);
-        dev->ctrl_dr->wIndex = cpu_to_le16(LAUNCHER_CTRL_INDEX);
-        dev->ctrl_dr->wLength = cpu_to_le16(LAUNCHER_CTRL_BUFFER_SIZE);
 
-        usb_fill_control_urb(dev->ctrl_urb, dev->udev,
-                        usb_sndctrlpipe(dev->udev, 0),
-                        (unsigned char *)dev->ctrl_dr,
-                        dev->ctrl_buffer,
-                        LAUNCHER_CTRL_BUFFER_SIZE,
-                        launcher_ctrl_callback,
-                        dev);
+        init_completion(&dev->write_done);
+        launcher_fill_ctrl_urb(dev, dev->write_urb, &dev->write_dr, dev->write_buffer,
+                               dev->dma_buffer_dma + int_end_size + LAUNCHER_CTRL_BUFFER_SIZE,
+                               launcher_write_callback);
 
         /* Retrieve a serial. */
         if (!usb_string(udev, udev->descriptor.iSerialNumber, dev->serial_number,
@@ -553,16 +1263,53 @@ static int launcher_probe(struct usb_interface *interface, const struct usb_devi
                 goto error;
         }
 
+        /*
+         * Poll the limit switches from now until disconnect, so position
+         * and homing survive close and zones stay armed between opens.
+         */
+        dev->position_time = ktime_get();
+        dev->int_in_running = 1;
+        mb();
+
+        retval = usb_submit_urb(dev->int_in_urb, GFP_KERNEL);
+        if (retval) {
+                pr_err("submitting int urb failed (%d)", retval);
+                dev->int_in_running = 0;
+                goto error;
+        }
+
         /* Save our data pointer in this interface device. */
         usb_set_intfdata(interface, dev);
 
+        /* Set up our class - the node can be opened as soon as this succeeds */
+        class.name = LAUNCHER_NODE"%d";
+        class.fops = &fops;
+        
+        if ((retval = usb_register_dev(interface, &class)) < 0) {
+                /* Something stopped us from registering this driver */
+                pr_err("Not able to get a minor for this device.");
+                usb_set_intfdata(interface, NULL);
+                launcher_abort_transfers(dev);
+                goto error;
+        } else {
+                pr_info("Minor receieved - %d\n", interface->minor);
+        }
+
         dev->minor = interface->minor;
 
+        if (dev->trace_buffer && launcher_debugfs) {
+                char name[16];
+
+                snprintf(name, sizeof(name), LAUNCHER_NODE"%d", dev->minor);
+                dev->trace_dentry = debugfs_create_file(name, 0400, launcher_debugfs,
+                                                        dev, &trace_fops);
+        }
+
 exit:
         return retval;
 
 error:
-        launcher_delete(dev);
+        kref_put(&dev->kref, launcher_delete);
         return retval;
 }
  
@@ -572,29 +1319,28 @@ static void launcher_disconnect(struct usb_interface *interface)
         int minor;
 
         pr_debug("launcher_disconnect\n");
-        mutex_lock(&disconnect_mutex);        /* Not interruptible */
 
         dev = usb_get_intfdata(interface);
         usb_set_intfdata(interface, NULL);
 
-        down(&dev->sem); /* Not interruptible */
-
         minor = dev->minor;
 
-        /* Give back our minor. */
+        /* Give back our minor - waits for any launcher_open() in flight. */
         usb_deregister_dev(interface, &class);
 
-        /* If the device is not opened, then we clean up right now. */
-        if (! dev->open_count) {
-                up(&dev->sem);
-                launcher_delete(dev);
-        } else {
-                dev->udev = NULL;
-                up(&dev->sem);
-        }
+        down(&dev->sem); /* Not interruptible */
+        dev->disconnected = 1;
+        launcher_abort_transfers(dev);
+        up(&dev->sem);
 
-        mutex_unlock(&disconnect_mutex);
-        
+        /* Release blocked trace readers before debugfs waits for them. */
+        wake_up_interruptible(&dev->trace_wait);
+        debugfs_remove(dev->trace_dentry);
+
+        /* Frees dev now unless a file still holds it open. */
+        kref_put(&dev->kref, launcher_delete);
+
+        pr_info("minor %d now disconnected", minor);
 }
 
 static int __init launcher_init(void)
@@ -603,6 +1349,12 @@ static int __init launcher_init(void)
 
         pr_debug("launcher_init\n");
         
+        if (trace) {
+                trace_records = roundup_pow_of_two(clamp_t(unsigned int, trace_records, 2,
+                                                           LAUNCHER_TRACE_MAX_RECORDS));
+                launcher_debugfs = debugfs_create_dir("launcher_driver", NULL);
+        }
+
         /* Wire up our probe/disconnect */
         launcher_driver.probe = launcher_probe;
         launcher_driver.disconnect = launcher_disconnect;
@@ -610,6 +1362,7 @@ static int __init launcher_init(void)
         /* Register this driver with the USB subsystem */
         if ((result = usb_register(&launcher_driver))) {
                 pr_err("usb_register() failed. Error number %d", result);
+                debugfs_remove_recursive(launcher_debugfs);
         }
         return result;
 }
@@ -619,6 +1372,7 @@ static void __exit launcher_exit(void)
         pr_debug("launcher_exit\n");
         /* Deregister this driver with the USB subsystem */
         usb_deregister(&launcher_driver);
+        debugfs_remove_recursive(launcher_debugfs);
 }
  
 module_init(launcher_init);
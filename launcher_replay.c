@@ -0,0 +1,345 @@
+/*
+ * Replays the commands of a trace recorded with `launcher_control -o` (or
+ * a previous replay) against a launcher, keeping the original spacing
+ * between commands, and reports how far the replay drifted from it.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "launcher.h"
+
+#define LAUNCHER_NODE           "/dev/launcher0"
+#define LAUNCHER_READ_RECORDS   256             /* Records fetched per read() */
+#define LAUNCHER_DRAIN_NS       100000000ULL    /* Drain the driver this often while waiting */
+
+struct trace {
+        struct launcher_trace_record    *rec;
+        long                            count;
+        long                            capacity;
+};
+
+struct deviation {
+        long                            samples;
+        long long                       sum_ns;
+        long long                       max_ns;         /* Largest absolute deviation */
+};
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until_ns(unsigned long long t)
+{
+        struct timespec ts;
+
+        ts.tv_sec = t / 1000000000ULL;
+        ts.tv_nsec = t % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+                /* Interrupted - go back to sleep */
+        }
+}
+
+static void deviation_add(struct deviation *d, long long ns)
+{
+        d->sum_ns += ns;
+        if (ns < 0) {
+                ns = -ns;
+        }
+        if (ns > d->max_ns) {
+                d->max_ns = ns;
+        }
+        ++d->samples;
+}
+
+static void deviation_print(const char *what, const struct deviation *d)
+{
+        if (!d->samples) {
+                printf("%-22s no samples\n", what);
+                return;
+        }
+        printf("%-22s %ld samples, mean %+.3f ms, max |%.3f| ms\n", what, d->samples,
+               d->sum_ns / (double)d->samples / 1e6, d->max_ns / 1e6);
+}
+
+/* Make room for at least n more records */
+static int trace_reserve(struct trace *t, long n)
+{
+        struct launcher_trace_record *rec;
+        long capacity = t->capacity ? t->capacity : LAUNCHER_READ_RECORDS;
+
+        while (capacity - t->count < n) {
+                capacity *= 2;
+        }
+        if (capacity == t->capacity) {
+                return 0;
+        }
+
+        rec = realloc(t->rec, capacity * sizeof(*rec));
+        if (!rec) {
+                fprintf(stderr, "Out of memory for %ld trace records\n", capacity);
+                return -1;
+        }
+        t->rec = rec;
+        t->capacity = capacity;
+        return 0;
+}
+
+static int trace_load(const char *path, struct trace *t)
+{
+        struct launcher_trace_header hdr;
+        size_t len;
+        FILE *in;
+
+        in = fopen(path, "rb");
+        if (!in) {
+                perror("Couldn't open trace file");
+                return -1;
+        }
+
+        if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != LAUNCHER_TRACE_MAGIC ||
+            hdr.version != LAUNCHER_TRACE_VERSION ||
+            hdr.record_size != sizeof(struct launcher_trace_record)) {
+                fprintf(stderr, "%s is not a launcher trace\n", path);
+                fclose(in);
+                return -1;
+        }
+
+        do {
+                if (trace_reserve(t, LAUNCHER_READ_RECORDS)) {
+                        fclose(in);
+                        return -1;
+                }
+                len = fread(&t->rec[t->count], sizeof(*t->rec), LAUNCHER_READ_RECORDS, in);
+                t->count += len;
+        } while (len == LAUNCHER_READ_RECORDS);
+
+        if (fgetc(in) != EOF) {
+                fprintf(stderr, "Warning: %s ends in a partial record, ignored\n", path);
+        }
+        fclose(in);
+        return 0;
+}
+
+/* Append whatever the driver's trace ring holds right now (read() never blocks) */
+static int trace_drain(int fd, struct trace *t)
+{
+        ssize_t len;
+
+        for (;;) {
+                if (trace_reserve(t, LAUNCHER_READ_RECORDS)) {
+                        return -1;
+                }
+                len = read(fd, &t->rec[t->count], LAUNCHER_READ_RECORDS * sizeof(*t->rec));
+                if (len <= 0) {
+                        return 0;
+                }
+                t->count += len / sizeof(*t->rec);
+        }
+}
+
+static int trace_save(const char *path, const struct trace *t)
+{
+        struct launcher_trace_header hdr;
+        FILE *out;
+
+        out = fopen(path, "wb");
+        if (!out) {
+                perror("Couldn't open output trace file");
+                return -1;
+        }
+        hdr.magic = LAUNCHER_TRACE_MAGIC;
+        hdr.version = LAUNCHER_TRACE_VERSION;
+        hdr.record_size = sizeof(struct launcher_trace_record);
+        fwrite(&hdr, sizeof(hdr), 1, out);
+        fwrite(t->rec, sizeof(*t->rec), t->count, out);
+        fclose(out);
+        return 0;
+}
+
+/*
+ * Sleep until t, draining the driver's ring along the way so a long replay
+ * cannot overflow it. The last drain happens well before t so it does not
+ * delay the command that follows.
+ */
+static void sleep_draining_until_ns(int fd, struct trace *replay, unsigned long long t)
+{
+        while (now_ns() + 2 * LAUNCHER_DRAIN_NS < t) {
+                trace_drain(fd, replay);
+                sleep_until_ns(now_ns() + LAUNCHER_DRAIN_NS);
+        }
+        sleep_until_ns(t);
+}
+
+static long trace_next(const struct trace *t, long i, int type)
+{
+        for (++i; i < t->count; ++i) {
+                if (t->rec[i].type == type) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+/* Next status report whose limit switch bits differ from the previous one */
+static long trace_next_transition(const struct trace *t, long i)
+{
+        long prev = i;
+
+        while ((i = trace_next(t, i, LAUNCHER_TRACE_STATUS)) >= 0) {
+                if (prev < 0 || t->rec[prev].type != LAUNCHER_TRACE_STATUS ||
+                    memcmp(t->rec[i].data, t->rec[prev].data, 2)) {
+                        return i;
+                }
+                prev = i;
+        }
+        return -1;
+}
+
+/*
+ * Compares events of the same kind pairwise, each measured from the
+ * first command of its own trace.
+ */
+static void trace_compare(const struct trace *orig, const struct trace *replay)
+{
+        struct deviation cmd = { 0 }, status = { 0 };
+        long o, r, o0, r0;
+
+        o0 = trace_next(orig, -1, LAUNCHER_TRACE_COMMAND);
+        r0 = trace_next(replay, -1, LAUNCHER_TRACE_COMMAND);
+        if (o0 < 0 || r0 < 0) {
+                printf("No driver trace to compare - was the module loaded with trace=1?\n");
+                return;
+        }
+
+        for (o = o0, r = r0; o >= 0 && r >= 0;
+             o = trace_next(orig, o, LAUNCHER_TRACE_COMMAND),
+             r = trace_next(replay, r, LAUNCHER_TRACE_COMMAND)) {
+                deviation_add(&cmd, (long long)(replay->rec[r].timestamp_ns - replay->rec[r0].timestamp_ns) -
+                                    (long long)(orig->rec[o].timestamp_ns - orig->rec[o0].timestamp_ns));
+        }
+
+        o = trace_next_transition(orig, o0);
+        r = trace_next_transition(replay, r0);
+        for (; o >= 0 && r >= 0; o = trace_next_transition(orig, o),
+                                 r = trace_next_transition(replay, r)) {
+                if (memcmp(orig->rec[o].data, replay->rec[r].data, 2)) {
+                        printf("Status diverged at transition %ld: %02x %02x, replay %02x %02x\n",
+                               status.samples, orig->rec[o].data[0], orig->rec[o].data[1],
+                               replay->rec[r].data[0], replay->rec[r].data[1]);
+                        break;
+                }
+                deviation_add(&status, (long long)(replay->rec[r].timestamp_ns - replay->rec[r0].timestamp_ns) -
+                                       (long long)(orig->rec[o].timestamp_ns - orig->rec[o0].timestamp_ns));
+        }
+
+        deviation_print("Driver command timing:", &cmd);
+        deviation_print("Limit switch timing:", &status);
+        for (o = 0; o < replay->count; ++o) {
+                if (replay->rec[o].type == LAUNCHER_TRACE_OVERFLOW) {
+                        printf("Warning: the replay trace overflowed, results are partial\n");
+                        break;
+                }
+        }
+}
+
+static void launcher_usage(char *name)
+{
+        fprintf(stderr, "Usage: %s [-m <device>] [-o <file>] <trace>\n"
+                        "\t-m\tmissile launcher [" LAUNCHER_NODE "]\n"
+                        "\t-o\tsave the replay's own trace to a file\n"
+                        "\t-h\tdisplay this help\n\n"
+                        "Notes:\n"
+                        "\tOnly commands written by user space are replayed, the driver\n"
+                        "\tregenerates its own limit switch corrections.\n"
+                        "", name);
+        exit(1);
+}
+
+int main(int argc, char **argv)
+{
+        int c;
+        int fd;
+        long i, first;
+        char *dev = LAUNCHER_NODE;
+        char *out_file = NULL;
+        struct trace orig = { 0 }, replay = { 0 }, stale = { 0 };
+        struct deviation issue = { 0 };
+        unsigned long long start, target, issued;
+        unsigned char cmd;
+
+        while ((c = getopt(argc, argv, "m:o:h")) != -1) {
+                switch (c) {
+                case 'm':
+                        dev = optarg;
+                        break;
+                case 'o':
+                        out_file = optarg;
+                        break;
+                default:
+                        launcher_usage(argv[0]);
+                        break;
+                }
+        }
+
+        if (optind != argc - 1) {
+                launcher_usage(argv[0]);
+        }
+
+        if (trace_load(argv[optind], &orig)) {
+                exit(1);
+        }
+
+        first = trace_next(&orig, -1, LAUNCHER_TRACE_COMMAND);
+        if (first < 0) {
+                fprintf(stderr, "%s holds no commands\n", argv[optind]);
+                exit(1);
+        }
+
+        fd = open(dev, O_RDWR);
+        if (fd == -1) {
+                perror("Couldn't open file: %m");
+                exit(1);
+        }
+
+        /* The ring outlives each open, drop anything recorded before this run */
+        trace_drain(fd, &stale);
+        free(stale.rec);
+
+        start = now_ns();
+        for (i = first; i >= 0; i = trace_next(&orig, i, LAUNCHER_TRACE_COMMAND)) {
+                target = start + (orig.rec[i].timestamp_ns - orig.rec[first].timestamp_ns);
+                sleep_draining_until_ns(fd, &replay, target);
+
+                cmd = orig.rec[i].data[0];
+                issued = now_ns();
+                if (write(fd, &cmd, 1) < 0) {
+                        perror("Could not send command");
+                }
+                deviation_add(&issue, (long long)(issued - target));
+        }
+
+        /* Let the tail of the original run play out so its status reports line up */
+        sleep_draining_until_ns(fd, &replay, start + (orig.rec[orig.count - 1].timestamp_ns -
+                                                      orig.rec[first].timestamp_ns));
+
+        printf("Replayed %ld commands from %s\n", issue.samples, argv[optind]);
+        deviation_print("Issue timing:", &issue);
+        if (!trace_drain(fd, &replay)) {
+                if (out_file) {
+                        trace_save(out_file, &replay);
+                }
+                trace_compare(&orig, &replay);
+        }
+
+        close(fd);
+        return EXIT_SUCCESS;
+}
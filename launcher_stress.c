@@ -0,0 +1,157 @@
+/*
+ * Open/write stress test across several launchers. For each device count
+ * N from 1 up to the number of nodes found, runs one thread per device that
+ * repeatedly opens its node, writes STOP a few times and closes it again,
+ * then reports the aggregate rate so scaling with N can be checked.
+ *
+ * Only STOP is ever written, so the launchers do not move.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LAUNCHER_NODE_PREFIX    "/dev/launcher"
+#define LAUNCHER_STOP           0x20
+#define LAUNCHER_MAX_DEVICES    64
+#define LAUNCHER_WRITES_PER_OPEN 8
+
+struct worker {
+        pthread_t               thread;
+        char                    node[64];
+        volatile int            *running;
+        unsigned long           opens;
+        unsigned long           writes;
+        unsigned long           errors;
+};
+
+static double now_s(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_run(void *arg)
+{
+        struct worker *w = arg;
+        unsigned char cmd = LAUNCHER_STOP;
+        int fd, i;
+
+        while (*w->running) {
+                fd = open(w->node, O_RDWR);
+                if (fd == -1) {
+                        ++w->errors;
+                        continue;
+                }
+                ++w->opens;
+
+                for (i = 0; i < LAUNCHER_WRITES_PER_OPEN; ++i) {
+                        if (write(fd, &cmd, 1) == 1) {
+                                ++w->writes;
+                        } else {
+                                ++w->errors;
+                        }
+                }
+                close(fd);
+        }
+        return NULL;
+}
+
+static void launcher_usage(char *name)
+{
+        fprintf(stderr, "Usage: %s [-n <devices>] [-d <secs>] [-p <prefix>]\n"
+                        "\t-n\tlargest number of launchers to drive [all found]\n"
+                        "\t-d\tseconds to run for each device count [5]\n"
+                        "\t-p\tdevice node prefix [" LAUNCHER_NODE_PREFIX "]\n"
+                        "\t-h\tdisplay this help\n"
+                        "", name);
+        exit(1);
+}
+
+int main(int argc, char **argv)
+{
+        int c, i, n;
+        int found = 0;
+        int max_devices = LAUNCHER_MAX_DEVICES;
+        unsigned int duration = 5;
+        char *prefix = LAUNCHER_NODE_PREFIX;
+        static struct worker workers[LAUNCHER_MAX_DEVICES];
+        volatile int running;
+        unsigned long opens, writes, errors;
+        double start, elapsed, base_rate = 0;
+
+        while ((c = getopt(argc, argv, "n:d:p:h")) != -1) {
+                switch (c) {
+                case 'n':
+                        max_devices = strtol(optarg, NULL, 10);
+                        break;
+                case 'd':
+                        duration = strtol(optarg, NULL, 10);
+                        break;
+                case 'p':
+                        prefix = optarg;
+                        break;
+                default:
+                        launcher_usage(argv[0]);
+                        break;
+                }
+        }
+
+        if (max_devices < 1 || max_devices > LAUNCHER_MAX_DEVICES || duration < 1) {
+                launcher_usage(argv[0]);
+        }
+
+        /* Use the first max_devices nodes that exist */
+        for (i = 0; i < LAUNCHER_MAX_DEVICES && found < max_devices; ++i) {
+                snprintf(workers[found].node, sizeof(workers[found].node), "%s%d", prefix, i);
+                if (access(workers[found].node, R_OK | W_OK) == 0) {
+                        ++found;
+                }
+        }
+
+        if (!found) {
+                fprintf(stderr, "No launchers found at %s<n>\n", prefix);
+                exit(1);
+        }
+
+        printf("%8s %12s %12s %10s %8s\n", "devices", "opens/s", "writes/s", "scaling", "errors");
+        for (n = 1; n <= found; ++n) {
+                running = 1;
+                for (i = 0; i < n; ++i) {
+                        workers[i].running = &running;
+                        workers[i].opens = workers[i].writes = workers[i].errors = 0;
+                        if ((errno = pthread_create(&workers[i].thread, NULL, worker_run,
+                                                    &workers[i]))) {
+                                perror("pthread_create");
+                                exit(1);
+                        }
+                }
+
+                start = now_s();
+                sleep(duration);
+                running = 0;
+
+                opens = writes = errors = 0;
+                for (i = 0; i < n; ++i) {
+                        pthread_join(workers[i].thread, NULL);
+                        opens += workers[i].opens;
+                        writes += workers[i].writes;
+                        errors += workers[i].errors;
+                }
+                elapsed = now_s() - start;
+
+                if (n == 1) {
+                        base_rate = writes / elapsed;
+                }
+                printf("%8d %12.1f %12.1f %9.2fx %8lu\n", n, opens / elapsed, writes / elapsed,
+                       base_rate > 0 ? writes / elapsed / base_rate : 0.0, errors);
+        }
+
+        return EXIT_SUCCESS;
+}